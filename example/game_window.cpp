@@ -16,6 +16,14 @@ GameWindow::GameWindow()
 ,font(graphics(), Gosu::defaultFontName(), 20)
 ,particle_emitter(graphics(), L"particle_arrow.png", RenderLayer::Particles, 150000)
 {
+    Particle p;
+    p.scale = 0.1;
+    p.color = Gosu::Color::AQUA;
+    p.fade = 0.3;
+    particle_emitter.setEmissionTemplate(p.TimeToLive(1000));
+    particle_emitter.setVelocitySpread(1.0/6, 1.0/6);
+    // Slow particles, 30 steps per second are enough.
+    particle_emitter.setSimulationRate(30);
 }
 
 GameWindow::~GameWindow()
@@ -34,7 +42,9 @@ void GameWindow::draw()
     wss << 1000/60;
     wss << L"ms - ";
     wss << particle_emitter.getCount();
-    wss << L" particles";
+    wss << L" particles - ";
+    wss << particle_emitter.getUploadBytesSaved() / 1024;
+    wss << L"KiB upload saved";
 	font.draw(wss.str(), 0, 0, RenderLayer::GUI);
 	graphics().drawTriangle(input().mouseX(), input().mouseY(), Gosu::Color::GRAY,
 							input().mouseX()+10, input().mouseY(), Gosu::Color::GRAY,
@@ -45,17 +55,8 @@ void GameWindow::draw()
 void GameWindow::update()
 {
     double start_time = Gosu::milliseconds();
-    if (input().down(Gosu::msRight)) {
-        for(int i = 0; i < 1000; i++) {
-            Particle p(input().mouseX(), input().mouseY());
-            p.scale = 0.1;
-            p.color = Gosu::Color::AQUA;
-            p.velocity_x = Gosu::random(-1, 1)/6;
-            p.velocity_y = Gosu::random(-1, 1)/6;
-            p.fade = 0.3;
-            particle_emitter.emit(p.TimeToLive(1000));
-        }
-    }
+    particle_emitter.setPosition(input().mouseX(), input().mouseY());
+    particle_emitter.setEmissionRate(input().down(Gosu::msRight) ? 1000 : 0);
     particle_emitter.update();
     update_time = Gosu::milliseconds() - start_time;
 }
@@ -66,5 +67,11 @@ void GameWindow::buttonUp(Gosu::Button btn)
         Particle p(input().mouseX(), input().mouseY());
         p.fade = 10;
         particle_emitter.emit(p.TimeToLive(300).AngularVelocity(10));
+    } else if (btn == Gosu::kbS) {
+        // Screenshot of the particles, rasterized without OpenGL.
+        SoftwareRenderer renderer(graphics().width(), graphics().height());
+        renderer.clear(Gosu::Color::BLACK);
+        particle_emitter.drawTo(renderer);
+        Gosu::saveImageFile(renderer.toBitmap(), L"particles.png");
     }
 }
@@ -0,0 +1,107 @@
+#include "EmitterShape.hpp"
+#include <algorithm>
+#include "fast_math.hpp"
+
+EmitterShape::EmitterShape()
+{
+    *this = point();
+}
+
+EmitterShape::EmitterShape(Type type, float a, float b, float c, float d)
+:type(type)
+{
+    params[0] = a;
+    params[1] = b;
+    params[2] = c;
+    params[3] = d;
+}
+
+EmitterShape EmitterShape::point()
+{
+    return EmitterShape(Point, 0, 0, 0, 0);
+}
+
+EmitterShape EmitterShape::line(float x1, float y1, float x2, float y2)
+{
+    return EmitterShape(Line, x1, y1, x2, y2);
+}
+
+EmitterShape EmitterShape::circle(float radius)
+{
+    return EmitterShape(Circle, radius, 0, 0, 0);
+}
+
+EmitterShape EmitterShape::ring(float inner_radius, float outer_radius)
+{
+    return EmitterShape(Ring, outer_radius, inner_radius, 0, 0);
+}
+
+EmitterShape EmitterShape::rectangle(float width, float height)
+{
+    return EmitterShape(Rectangle, width, height, 0, 0);
+}
+
+EmitterShape EmitterShape::polygonEdge(const std::vector<Vertex2d>& points)
+{
+    if (points.empty()) {
+        return point();
+    }
+    EmitterShape shape(PolygonEdge, 0, 0, 0, 0);
+    shape.points = points;
+    float length = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        const Vertex2d& from = points[i];
+        const Vertex2d& to = points[(i + 1) % points.size()];
+        float dx = to.x - from.x;
+        float dy = to.y - from.y;
+        length += sqrt(dx * dx + dy * dy);
+        shape.edge_ends.push_back(length);
+    }
+    return shape;
+}
+
+void EmitterShape::sample(float u, float v, float& x, float& y) const
+{
+    switch (type) {
+    case Point:
+        x = y = 0;
+        break;
+    case Line:
+        x = params[0] + (params[2] - params[0]) * u;
+        y = params[1] + (params[3] - params[1]) * u;
+        break;
+    case Circle:
+    case Ring:
+    {
+        // sqrt keeps the density even, otherwise particles clump in the center
+        float inner = params[1] * params[1];
+        float outer = params[0] * params[0];
+        float radius = sqrt(inner + (outer - inner) * v);
+        size_t angle = size_t(u * LOOKUPS_PER_CIRCLE);
+        x = fast_lookup_cos(angle) * radius;
+        y = fast_lookup_sin(angle) * radius;
+        break;
+    }
+    case Rectangle:
+        x = (u - 0.5f) * params[0];
+        y = (v - 0.5f) * params[1];
+        break;
+    case PolygonEdge:
+    {
+        // pick a point along the outline, then find the edge it lies on
+        float distance = u * edge_ends.back();
+        size_t edge = std::upper_bound(edge_ends.begin(), edge_ends.end(), distance) - edge_ends.begin();
+        if (edge >= points.size()) {
+            edge = points.size() - 1;
+        }
+        float edge_start = edge == 0 ? 0 : edge_ends[edge - 1];
+        float edge_length = edge_ends[edge] - edge_start;
+        float t = edge_length > 0 ? (distance - edge_start) / edge_length : 0;
+        const Vertex2d& from = points[edge];
+        const Vertex2d& to = points[(edge + 1) % points.size()];
+        x = from.x + (to.x - from.x) * t;
+        y = from.y + (to.y - from.y) * t;
+        break;
+    }
+    }
+}
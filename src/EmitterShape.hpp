@@ -0,0 +1,51 @@
+#ifndef EMITTER_SHAPE_HPP
+#define EMITTER_SHAPE_HPP
+
+#include <vector>
+#include "Vertex2d.hpp"
+
+// Area new particles are spawned in, relative to the position of the emitter.
+class EmitterShape
+{
+public:
+    enum Type {
+        Point,
+        Line,
+        Circle,
+        Ring,
+        Rectangle,
+        PolygonEdge
+    };
+
+private:
+    Type type;
+    // Line: start and end point
+    // Circle/Ring: outer and inner radius
+    // Rectangle: width and height
+    float params[4];
+    // corners of the polygon, the last one connects back to the first one
+    std::vector<Vertex2d> points;
+    // length of the polygon outline up to the end of each edge
+    std::vector<float> edge_ends;
+
+    EmitterShape(Type type, float a, float b, float c, float d);
+public:
+    // default is a single point at the emitter position
+    EmitterShape();
+
+    static EmitterShape point();
+    static EmitterShape line(float x1, float y1, float x2, float y2);
+    static EmitterShape circle(float radius);
+    static EmitterShape ring(float inner_radius, float outer_radius);
+    // centered on the emitter position
+    static EmitterShape rectangle(float width, float height);
+    // particles are spawned on the outline of the closed polygon
+    static EmitterShape polygonEdge(const std::vector<Vertex2d>& points);
+
+    Type getType() const { return type; }
+
+    // Maps two random values in [0, 1) to a position evenly distributed over the shape.
+    void sample(float u, float v, float& x, float& y) const;
+};
+
+#endif // EMITTER_SHAPE_HPP
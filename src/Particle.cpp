@@ -3,32 +3,44 @@
 
 //static_assert(std::numeric_limits<decltype(Particle::angle)>::max() > NUM_LOOKUP_VALUES*2, "Particle::angle doesn't have enough bits for the lookup table and safe rotations");
 
-void Particle::update()
+void Particle::update(float ticks, uint16_t elapsed_ticks)
 {
+    reset_interpolation();
+
     // Apply friction
-    velocity_x *= 1.0 - friction;
-    velocity_y *= 1.0 - friction;
+    float keep = 1.0 - friction;
+    if (ticks != 1) {
+        // friction above 1 flips the velocity every tick, pow can't do that for fractional ticks
+        bool flip = keep < 0 && (int(ticks + 0.5f) % 2 == 1);
+        keep = pow(fabs(keep), ticks);
+        if (flip) {
+            keep = -keep;
+        }
+    }
+    velocity_x *= keep;
+    velocity_y *= keep;
 
     // Gravity.
     velocity_y += /*gravity*/ 0.0;
 
     // Move
-    x += velocity_x;
-    y += velocity_y;
+    x += velocity_x * ticks;
+    y += velocity_y * ticks;
 
     // Rotate.
-    angle += angular_velocity;
-    if (angle >= LOOKUPS_PER_CIRCLE) {
-        angle -= LOOKUPS_PER_CIRCLE;
-    }
+    angle = (angle + uint32_t(angular_velocity * ticks + 0.5f)) % LOOKUPS_PER_CIRCLE;
 
     // Resize.
-    scale += zoom;
+    scale += zoom * ticks;
 
     // Fade out.
-    color.alpha -= (fade / 255.0);
+    color.alpha -= (fade / 255.0) * ticks;
 
-    time_to_live--;
+    if (time_to_live > elapsed_ticks) {
+        time_to_live -= elapsed_ticks;
+    } else {
+        time_to_live = 0;
+    }
 
     // Die if out of time, invisible or shrunk to nothing.
     if((color.alpha <= 0) ||
@@ -1,5 +1,8 @@
 #include <Gosu/Color.hpp>
 
+// All per frame values of a particle are per tick, independent of the emitter's simulation rate.
+#define PARTICLE_TICKS_PER_SECOND 60
+
 //static_assert(sizeof(Gosu::Color)==4, "Gosu::Color doesn't have 4 bytes");
 
 // Colour based on float values (0.0..1.0)
@@ -55,6 +58,12 @@ struct Particle
     // Time to die.
     uint16_t time_to_live;
 
+    // State before the last update, drawing interpolates between this and the current state.
+    float prev_x, prev_y;
+    float prev_scale;
+    float prev_alpha;
+    uint16_t prev_angle;
+
     Particle Angle(float gosu_degrees) const;
     Particle AngularVelocity(float gosu_degrees_per_frame) const;
     Particle TimeToLive(uint16_t frames) const;
@@ -84,7 +93,19 @@ struct Particle
         friction = 0.0;
         angle = 0;
         time_to_live = 0.0;
+        reset_interpolation();
+    }
+
+    // Makes the particle appear at its current state, e.g. after being placed.
+    void reset_interpolation()
+    {
+        prev_x = x;
+        prev_y = y;
+        prev_scale = scale;
+        prev_alpha = color.alpha;
+        prev_angle = angle;
     }
 
-    void update();
+    // ticks: length of the update, elapsed_ticks: the same rounded for time_to_live
+    void update(float ticks, uint16_t elapsed_ticks);
 };
@@ -9,63 +9,151 @@
 
 static void write_particle_vertices(VertexIterator& vertex,
                                          Particle& particle,
-                                         const uint width, const uint height);
+                                         const uint width, const uint height,
+                                         float interpolation);
 
 static void write_particle_texture_coords(VertexIterator& texture_coord,
                                                Gosu::GLTexInfo texture_info);
 
 static void write_particle_colors(ColorIterator& color_out, Color_f& color_in);
 static void write_colors_for_particles(ColorIterator& color,
-                                       ParticleIterator first, ParticleIterator end);
+                                       ParticleIterator first, ParticleIterator end,
+                                       float interpolation);
 
 
 bool ParticleEmitter::initialized_fast_math = false;
+uint32_t ParticleEmitter::emitters_created = 0;
 
 ParticleEmitter::ParticleEmitter(Gosu::Graphics& graphics, std::wstring filename, Gosu::ZPos z, size_t max_particles)
-:graphics(graphics)
-,image(graphics, filename)
+:graphics(&graphics)
+,image(new Gosu::Image(graphics, filename))
 ,z(z)
 ,max_particles(max_particles)
+{
+    try
+    {
+        // Fill the array with all the same coords (won't be used if the image changes dynamically).
+        init(image->width(), image->height(), *image->getData().glTexInfo());
+
+        init_vbo();
+    }
+    catch(...)
+    {
+        // The destructor won't run, so it can't free the image.
+        delete image;
+        throw;
+    }
+
+    // Push whole array to graphics card.
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_id);
+
+    glBufferSubData(GL_ARRAY_BUFFER, texture_coords_array_offset,
+                       sizeof(Vertex2d) * VERTICES_IN_PARTICLE * max_particles,
+                       texture_coords_array.data());
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ParticleEmitter::ParticleEmitter(const Gosu::Bitmap& texture, size_t max_particles)
+:graphics(NULL)
+,image(NULL)
+,software_texture(texture)
+,z(0)
+,max_particles(max_particles)
+{
+    // Texture coords are relative to the bitmap.
+    Gosu::GLTexInfo whole_bitmap;
+    whole_bitmap.texName = 0;
+    whole_bitmap.left = whole_bitmap.top = 0;
+    whole_bitmap.right = whole_bitmap.bottom = 1;
+    init(texture.width(), texture.height(), whole_bitmap);
+}
+
+void ParticleEmitter::init(size_t image_width, size_t image_height, const Gosu::GLTexInfo& tex_info)
 {
     if (!initialized_fast_math) {
         initialize_fast_math();
         initialized_fast_math = true;
     }
 
-    init_vbo();
+    int num_vertices = max_particles * VERTICES_IN_PARTICLE;
+    color_array.resize(num_vertices);
+    texture_coords_array.resize(num_vertices);
+    vertex_array.resize(num_vertices);
 
     // default Particle constructor is just fine
     particles.resize(max_particles);
     next_particle = particles.begin();
     count = 0;
+    drawn_count = 0;
+
+    // Nothing is emitted automatically until a rate is set.
+    position_x = position_y = 0;
+    emission_rate = 0;
+    emission_accumulator = 0;
+    velocity_spread_x = velocity_spread_y = 0;
+    // Different for every emitter, never 0 or xorshift would get stuck.
+    emitters_created++;
+    random_state = 2463534242u ^ (emitters_created * 2654435761u);
+    if(random_state == 0) random_state = 2463534242u;
+
+    simulation_step = 1.0 / PARTICLE_TICKS_PER_SECOND;
+    time_accumulator = 0;
+    tick_accumulator = 0;
+    interpolation = 0;
+
+    collision_enabled = false;
+    floor_y = 0;
+    bounce = 0;
+
+    // Nothing has been uploaded yet.
+    layout_changed = true;
+    particles_moving = false;
+    moved_last_step = false;
+    colors_fading = false;
+    colors_uniform = false;
+    color_array_valid = false;
+    upload_bytes_saved = 0;
 
     // Pixel size of image.
-    width = image.width();
-    height = image.height();
+    width = image_width;
+    height = image_height;
 
-    // Fill the array with all the same coords (won't be used if the image changes dynamically).
-    texture_info = *image.getData().glTexInfo();
+    texture_info = tex_info;
 
     write_texture_coords_for_all_particles();
-
-    // Push whole array to graphics card.
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_id);
-
-    glBufferSubData(GL_ARRAY_BUFFER, texture_coords_array_offset,
-                       sizeof(Vertex2d) * VERTICES_IN_PARTICLE * max_particles,
-                       texture_coords_array.data());
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void ParticleEmitter::draw()
 {
-    if(count == 0) return;
+    if(!graphics)
+    {
+        throw std::runtime_error("ParticleEmitter without Gosu::Graphics can only be drawn with drawTo");
+    }
+
+    if(drawn_count == 0) return;
 
     // Run the actual drawing operation at the correct Z-order.
-    graphics.beginGL();
+    graphics->beginGL();
     draw_vbo();
-    graphics.endGL();
+    graphics->endGL();
+}
+
+void ParticleEmitter::drawTo(SoftwareRenderer& renderer)
+{
+    if(drawn_count == 0) return;
+
+    // Read the image back from the graphics card once.
+    if(software_texture.empty())
+    {
+        // Software only emitter created from an empty bitmap, nothing to draw with.
+        if(!image) return;
+        software_texture = SoftwareTexture(image->getData().toBitmap());
+    }
+
+    renderer.drawQuads(vertex_array.data(), colors_uniform ? NULL : color_array.data(),
+                       texture_coords_array.data(), drawn_count, software_texture, texture_info,
+                       uniform_color);
 }
 
 void ParticleEmitter::draw_vbo()
@@ -77,8 +165,15 @@ void ParticleEmitter::draw_vbo()
     glBindBuffer(GL_ARRAY_BUFFER, vbo_id);
 
     // Only use colour array if colours are dynamic. Otherwise a single colour setting is enough.
+    if(colors_uniform)
+    {
+        glColor4ub(uniform_color.red(), uniform_color.green(), uniform_color.blue(), uniform_color.alpha());
+    }
+    else
+    {
         glEnableClientState(GL_COLOR_ARRAY);
         glColorPointer(4, GL_UNSIGNED_BYTE, 0, (void*)color_array_offset);
+    }
 
     // Always use the texture array, even if it is static.
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
@@ -88,11 +183,12 @@ void ParticleEmitter::draw_vbo()
     glEnableClientState(GL_VERTEX_ARRAY);
     glVertexPointer(2, GL_FLOAT, 0, (void*)vertex_array_offset);
 
-    glDrawArrays(GL_QUADS, 0, count * VERTICES_IN_PARTICLE);
+    glDrawArrays(GL_QUADS, 0, drawn_count * VERTICES_IN_PARTICLE);
 
     glDisableClientState(GL_COLOR_ARRAY);
     glDisableClientState(GL_TEXTURE_COORD_ARRAY);
     glDisableClientState(GL_VERTEX_ARRAY);
+    glColor4ub(255, 255, 255, 255);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
@@ -106,13 +202,8 @@ void ParticleEmitter::init_vbo()
 
     int num_vertices = max_particles * VERTICES_IN_PARTICLE;
 
-    color_array.resize(num_vertices);
     color_array_offset = 0;
-
-    texture_coords_array.resize(num_vertices);
     texture_coords_array_offset = sizeof(Gosu::Color) * num_vertices;
-
-    vertex_array.resize(num_vertices);
     vertex_array_offset = (sizeof(Gosu::Color) + sizeof(Vertex2d)) * num_vertices;
 
     // Create the VBO, but don't upload any data yet.
@@ -137,8 +228,103 @@ bool ParticleEmitter::texture_changes() const
     return false;
 }
 
+bool ParticleEmitter::colors_change() const
+{
+    return !colors_uniform && (layout_changed || colors_fading || !color_array_valid);
+}
+
+bool ParticleEmitter::vertices_change() const
+{
+    return layout_changed || particles_moving;
+}
+
+void ParticleEmitter::setSimulationRate(double steps_per_second)
+{
+    if(!(steps_per_second > 0))
+    {
+        throw std::runtime_error("ParticleEmitter simulation rate must be positive");
+    }
+    simulation_step = 1.0 / steps_per_second;
+}
+
 void ParticleEmitter::update()
 {
+    update(1.0 / PARTICLE_TICKS_PER_SECOND);
+}
+
+void ParticleEmitter::update(double seconds)
+{
+    events.clear();
+
+    // Run as many fixed steps as fit into the elapsed time, the rest is carried over.
+    time_accumulator += seconds;
+    if(time_accumulator > simulation_step + MAX_SIMULATION_LAG)
+    {
+        // Don't try to catch up after a stall, that would only make it longer.
+        time_accumulator = simulation_step;
+    }
+    size_t steps = 0;
+    while(time_accumulator + 1e-9 >= simulation_step)
+    {
+        if(steps == 0)
+        {
+            // Found out while simulating, so update_vbo can skip streams that didn't change.
+            particles_moving = false;
+            colors_fading = false;
+            colors_uniform = true;
+        }
+        simulate();
+        time_accumulator -= simulation_step;
+        steps++;
+    }
+    if(time_accumulator < 0) time_accumulator = 0;
+    interpolation = time_accumulator / simulation_step;
+
+    // Particles were created, killed or changed since the last step.
+    if(steps == 0 && layout_changed) find_uniform_color();
+
+    // Interpolated alpha isn't uniform, even if the colours are.
+    if(colors_fading) colors_uniform = false;
+
+    // Copy all the current data onto the graphics card.
+    drawn_count = count;
+    upload_bytes_saved = 0;
+    if(count > 0) update_vbo();
+}
+
+void ParticleEmitter::simulate()
+{
+    float ticks = simulation_step * PARTICLE_TICKS_PER_SECOND;
+
+    // time_to_live counts whole ticks, carry fractions over.
+    tick_accumulator += ticks;
+    uint16_t elapsed_ticks;
+    if(tick_accumulator + 1e-4 >= 0xFFFF)
+    {
+        // Longer than any time_to_live, everything dies this step.
+        elapsed_ticks = 0xFFFF;
+        tick_accumulator = 0;
+    }
+    else
+    {
+        elapsed_ticks = uint16_t(tick_accumulator + 1e-4);
+        tick_accumulator -= elapsed_ticks;
+    }
+
+    // Spawn this step's share of the emission rate, carrying the remainder over.
+    emission_accumulator += emission_rate * ticks;
+    size_t to_emit = size_t(emission_accumulator);
+    emission_accumulator -= to_emit;
+    if(to_emit > 0)
+    {
+        emit_batch(emission_template, shape, position_x, position_y, 0, 0,
+                   velocity_spread_x, velocity_spread_y, to_emit);
+    }
+
+    size_t first_event = events.size();
+    const Color_f* first_color = NULL;
+    bool moved = false;
+
     if(count > 0)
     {
         for(ParticleIterator it = particles.begin(); it != particles.end(); it++)
@@ -147,20 +333,116 @@ void ParticleEmitter::update()
             // Ignore particles that are already dead.
             if(particle.time_to_live > 0)
             {
-                particle.update();
+                particle.update(ticks, elapsed_ticks);
                 if(particle.time_to_live == 0) {
                     count -= 1;
+                    layout_changed = true;
+                    ParticleEvent event = { ParticleEvent::Death, particle.x, particle.y,
+                                            particle.velocity_x, particle.velocity_y };
+                    events.push_back(event);
+                    continue;
+                }
+
+                if(collision_enabled && particle.y > floor_y && particle.velocity_y > 0)
+                {
+                    particle.y = floor_y;
+                    particle.velocity_y *= -bounce;
+                    ParticleEvent event = { ParticleEvent::Collision, particle.x, particle.y,
+                                            particle.velocity_x, particle.velocity_y };
+                    events.push_back(event);
+                }
+
+                // Compared after the floor snap, which moves particles without velocity.
+                moved |= (particle.x != particle.prev_x) | (particle.y != particle.prev_y) |
+                         (particle.angle != particle.prev_angle) | (particle.scale != particle.prev_scale);
+                colors_fading |= (particle.fade != 0);
+                if(!first_color)
+                {
+                    first_color = &particle.color;
+                }
+                else
+                {
+                    colors_uniform &= (particle.color.red == first_color->red) &
+                                      (particle.color.green == first_color->green) &
+                                      (particle.color.blue == first_color->blue) &
+                                      (particle.color.alpha == first_color->alpha);
                 }
             }
         }
     }
 
-    // Copy all the current data onto the graphics card.
-    if(count > 0) update_vbo();
+    // Children are only spawned after all particles moved, never from within the loop above.
+    if(events.size() > first_event && !sub_emitters.empty()) process_events(first_event);
+
+    if(first_color) uniform_color = *first_color;
+
+    // Particles are drawn between their previous and current state, so the drawn
+    // state also changes in the step after the last movement.
+    particles_moving |= moved || moved_last_step;
+    moved_last_step = moved;
+}
+
+void ParticleEmitter::find_uniform_color()
+{
+    colors_uniform = true;
+    const Color_f* first_color = NULL;
+    for(ParticleIterator it = particles.begin(); it != particles.end(); it++)
+    {
+        const Particle& particle = *it;
+        if(particle.time_to_live == 0) continue;
+
+        if(!first_color)
+        {
+            first_color = &particle.color;
+        }
+        else
+        {
+            colors_uniform &= (particle.color.red == first_color->red) &
+                              (particle.color.green == first_color->green) &
+                              (particle.color.blue == first_color->blue) &
+                              (particle.color.alpha == first_color->alpha);
+        }
+    }
+    if(first_color) uniform_color = *first_color;
+}
+
+void ParticleEmitter::kill_in_rect(float left, float top, float right, float bottom)
+{
+    if(count == 0) return;
+
+    size_t killed = 0;
+    for(ParticleIterator it = particles.begin(); it != particles.end(); it++)
+    {
+        Particle& particle = *it;
+        if(particle.time_to_live > 0 &&
+           particle.x >= left && particle.x < right &&
+           particle.y >= top && particle.y < bottom)
+        {
+            particle.time_to_live = 0;
+            killed++;
+        }
+    }
+    count -= killed;
+    if(killed > 0) layout_changed = true;
+    if(count == 0) next_particle = particles.begin();
+}
+
+void ParticleEmitter::clear()
+{
+    for(ParticleIterator it = particles.begin(); it != particles.end(); it++)
+    {
+        it->time_to_live = 0;
+    }
+    count = 0;
+    next_particle = particles.begin();
+    layout_changed = true;
 }
 
 void ParticleEmitter::update_vbo()
 {
+    bool write_colors = colors_change();
+    bool write_vertices = vertices_change();
+
     // Ensure that drawing order is correct by drawing in order of creation...
 
     // First, we draw all those from after the current, going up to the last one.
@@ -169,14 +451,20 @@ void ParticleEmitter::update_vbo()
     ColorIterator color = color_array.begin();
     VertexIterator texCoord = texture_coords_array.begin();
     VertexIterator vertex = vertex_array.begin();
-    write_colors_for_particles(color,
-                                   first, end);
+    if(write_colors)
+    {
+        write_colors_for_particles(color,
+                                   first, end, interpolation);
+    }
     if(texture_changes())
     {
         write_texture_coords_for_particles(texCoord,
                                            first, end);
     }
-    write_vertices_for_particles(vertex, first, end);
+    if(write_vertices)
+    {
+        write_vertices_for_particles(vertex, first, end);
+    }
 
     // When we copy the second half of the particles, we want to start writing further on.
     // therefore we keep the color, texCoord and vertex iterators
@@ -186,8 +474,11 @@ void ParticleEmitter::update_vbo()
     {
         first = particles.begin();
         end = next_particle;
-        write_colors_for_particles(color,
-                                       first, end);
+        if(write_colors)
+        {
+            write_colors_for_particles(color,
+                                       first, end, interpolation);
+        }
 
         if(texture_changes())
         {
@@ -195,36 +486,110 @@ void ParticleEmitter::update_vbo()
                                                first, end);
         }
 
-        write_vertices_for_particles(vertex,
-                                     first, end);
+        if(write_vertices)
+        {
+            write_vertices_for_particles(vertex,
+                                         first, end);
+        }
     }
 
+    // The colour array is left untouched while a single colour is used.
+    if(write_colors) color_array_valid = true;
+    if(colors_uniform) color_array_valid = false;
+    layout_changed = false;
+
+    size_t num_vertices = VERTICES_IN_PARTICLE * count;
+    if(!write_colors) upload_bytes_saved += sizeof(Gosu::Color) * num_vertices;
+    if(!write_vertices) upload_bytes_saved += sizeof(Vertex2d) * num_vertices;
+
+    // Software only emitters have nothing to upload.
+    if(!graphics) return;
+    if(!write_colors && !texture_changes() && !write_vertices) return;
+
     // Upload the data, but only as much as we are actually using.
     glBindBuffer(GL_ARRAY_BUFFER, vbo_id);
-    glBufferSubData(GL_ARRAY_BUFFER, color_array_offset,
-                           sizeof(Gosu::Color) * VERTICES_IN_PARTICLE * count,
+    if(write_colors)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, color_array_offset,
+                           sizeof(Gosu::Color) * num_vertices,
                            color_array.data());
+    }
 
     if(texture_changes())
     {
         glBufferSubData(GL_ARRAY_BUFFER, texture_coords_array_offset,
-                           sizeof(Vertex2d) * VERTICES_IN_PARTICLE * count,
+                           sizeof(Vertex2d) * num_vertices,
                            texture_coords_array.data());
     }
 
-    glBufferSubData(GL_ARRAY_BUFFER, vertex_array_offset,
-                       sizeof(Vertex2d) * VERTICES_IN_PARTICLE * count,
-                       vertex_array.data());
+    if(write_vertices)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, vertex_array_offset,
+                           sizeof(Vertex2d) * num_vertices,
+                           vertex_array.data());
+    }
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 ParticleEmitter::~ParticleEmitter()
 {
-    glDeleteBuffers(1, &vbo_id);
+    if(graphics) glDeleteBuffers(1, &vbo_id);
+    delete image;
 }
 
 void ParticleEmitter::emit(Particle p)
+{
+    Particle& particle = allocate_particle();
+    particle = p;
+    particle.reset_interpolation();
+}
+
+void ParticleEmitter::process_events(size_t first_event)
+{
+    for(SubEmitterIterator sub = sub_emitters.begin(); sub != sub_emitters.end(); sub++)
+    {
+        ParticleEmitter& target = sub->target ? *sub->target : *this;
+        for(EventIterator event = events.begin() + first_event; event != events.end(); event++)
+        {
+            if(event->type != sub->trigger) continue;
+            // Children spawned into this emitter weren't checked for their colour.
+            if(&target == this) colors_uniform = false;
+            target.emit_batch(sub->particle, sub->shape, event->x, event->y,
+                              event->velocity_x * sub->inherit_velocity,
+                              event->velocity_y * sub->inherit_velocity,
+                              sub->velocity_spread_x, sub->velocity_spread_y, sub->count);
+        }
+    }
+}
+
+void ParticleEmitter::emit_batch(const Particle& particle_template, const EmitterShape& spawn_shape,
+                                 float x, float y, float velocity_x, float velocity_y,
+                                 float spread_x, float spread_y, size_t n)
+{
+    // Particles without a lifetime would be dead on arrival.
+    if(particle_template.time_to_live == 0) return;
+
+    // Emitting more than fit would only overwrite the ones we just created.
+    if(n > max_particles) n = max_particles;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        Particle& particle = allocate_particle();
+        particle = particle_template;
+
+        float offset_x, offset_y;
+        spawn_shape.sample(random_float(), random_float(), offset_x, offset_y);
+        particle.x += x + offset_x;
+        particle.y += y + offset_y;
+
+        particle.velocity_x += velocity_x + (random_float() * 2 - 1) * spread_x;
+        particle.velocity_y += velocity_y + (random_float() * 2 - 1) * spread_y;
+        particle.reset_interpolation();
+    }
+}
+
+Particle& ParticleEmitter::allocate_particle()
 {
     // Find the first dead particle in the heap, or overwrite the oldest one.
     Particle& particle = *next_particle;
@@ -234,6 +599,7 @@ void ParticleEmitter::emit(Particle p)
     {
         count++; // Dead or never been used.
     }
+    layout_changed = true;
 
     // Lets move the index onto the next one, or loop around.
     next_particle++;
@@ -241,20 +607,40 @@ void ParticleEmitter::emit(Particle p)
         next_particle = particles.begin();
     }
 
-    particle = p;
+    return particle;
 }
 
 
 // ----------------------------------------
 static void write_particle_vertices(VertexIterator& vertex, Particle& particle,
-                                         const uint width, const uint height)
+                                         const uint width, const uint height,
+                                         float interpolation)
 {
+    // Draw between the previous and the current simulation step.
+    float x = particle.prev_x + (particle.x - particle.prev_x) * interpolation;
+    float y = particle.prev_y + (particle.y - particle.prev_y) * interpolation;
+    float scale = particle.prev_scale + (particle.scale - particle.prev_scale) * interpolation;
+
+    // Rotate the short way round, the angle may have wrapped.
+    int turn = int(particle.angle) - int(particle.prev_angle);
+    if (turn > LOOKUPS_PER_CIRCLE / 2) {
+        turn -= LOOKUPS_PER_CIRCLE;
+    } else if (turn < -LOOKUPS_PER_CIRCLE / 2) {
+        turn += LOOKUPS_PER_CIRCLE;
+    }
+    int angle = particle.prev_angle + int(turn * interpolation);
+    if (angle < 0) {
+        angle += LOOKUPS_PER_CIRCLE;
+    } else if (angle >= LOOKUPS_PER_CIRCLE) {
+        angle -= LOOKUPS_PER_CIRCLE;
+    }
+
     // Totally ripped this code from Gosu :$
-    float sizeX = width * particle.scale;
-    float sizeY = height * particle.scale;
+    float sizeX = width * scale;
+    float sizeY = height * scale;
 
-    float offsX = fast_lookup_cos(particle.angle);
-    float offsY = fast_lookup_sin(particle.angle);
+    float offsX = fast_lookup_cos(angle);
+    float offsY = fast_lookup_sin(angle);
 
     float distToLeftX   = +offsY * sizeX * particle.center_x;
     float distToLeftY   = -offsX * sizeX * particle.center_x;
@@ -265,20 +651,20 @@ static void write_particle_vertices(VertexIterator& vertex, Particle& particle,
     float distToBottomX = -offsX * sizeY * (1 - particle.center_y);
     float distToBottomY = -offsY * sizeY * (1 - particle.center_y);
 
-    vertex->x = particle.x + distToLeftX  + distToTopX;
-    vertex->y = particle.y + distToLeftY  + distToTopY;
+    vertex->x = x + distToLeftX  + distToTopX;
+    vertex->y = y + distToLeftY  + distToTopY;
     vertex++;
 
-    vertex->x = particle.x + distToRightX + distToTopX;
-    vertex->y = particle.y + distToRightY + distToTopY;
+    vertex->x = x + distToRightX + distToTopX;
+    vertex->y = y + distToRightY + distToTopY;
     vertex++;
 
-    vertex->x = particle.x + distToRightX + distToBottomX;
-    vertex->y = particle.y + distToRightY + distToBottomY;
+    vertex->x = x + distToRightX + distToBottomX;
+    vertex->y = y + distToRightY + distToBottomY;
     vertex++;
 
-    vertex->x = particle.x + distToLeftX  + distToBottomX;
-    vertex->y = particle.y + distToLeftY  + distToBottomY;
+    vertex->x = x + distToLeftX  + distToBottomX;
+    vertex->y = y + distToLeftY  + distToBottomY;
     vertex++;
 }
 
@@ -292,7 +678,7 @@ void ParticleEmitter::write_vertices_for_particles(VertexIterator& vertex,
         Particle& particle = *first;
         if(particle.time_to_live > 0)
         {
-            write_particle_vertices(vertex, particle, width, height);
+            write_particle_vertices(vertex, particle, width, height, interpolation);
         }
     }
 }
@@ -359,14 +745,17 @@ static void write_particle_colors(ColorIterator& color_out, Color_f& color)
 
 // ----------------------------------------
 static void write_colors_for_particles(ColorIterator& color,
-                                       ParticleIterator first, ParticleIterator end)
+                                       ParticleIterator first, ParticleIterator end,
+                                       float interpolation)
 {
     for(;first != end; first++)
     {
         Particle& particle = *first;
         if(particle.time_to_live > 0)
         {
-            write_particle_colors(color, particle.color);
+            Color_f particle_color = particle.color;
+            particle_color.alpha = particle.prev_alpha + (particle.color.alpha - particle.prev_alpha) * interpolation;
+            write_particle_colors(color, particle_color);
         }
     }
 }
@@ -11,14 +11,13 @@
 #include <Gosu/Image.hpp>
 #include <Gosu/ImageData.hpp>
 #include "Particle.hpp"
+#include "EmitterShape.hpp"
+#include "SoftwareRenderer.hpp"
 
 #define VERTICES_IN_PARTICLE 4
 
-typedef struct _vertex2d
-{
-    float x, y;
-} Vertex2d;
-
+// Seconds the simulation may fall behind before an update drops the time instead of catching up.
+#define MAX_SIMULATION_LAG 0.25
 
 typedef std::vector<Particle> ParticleArray;
 typedef ParticleArray::iterator ParticleIterator;
@@ -27,10 +26,57 @@ typedef VertexArray::iterator VertexIterator;
 typedef std::vector<Gosu::Color> ColorArray;
 typedef ColorArray::iterator ColorIterator;
 
+class ParticleEmitter;
+
+// Something that happened to a particle during the last update.
+struct ParticleEvent
+{
+    enum Type {
+        Death,
+        Collision
+    };
+    Type type;
+    float x, y;
+    float velocity_x, velocity_y;
+};
+
+typedef std::vector<ParticleEvent> EventArray;
+typedef EventArray::const_iterator EventIterator;
+
+// Spawns new particles wherever particles of the owning emitter die or collide.
+struct SubEmitter
+{
+    ParticleEvent::Type trigger;
+    // position is relative to the event position
+    Particle particle;
+    // number of particles spawned per event
+    size_t count;
+    EmitterShape shape;
+    float velocity_spread_x, velocity_spread_y;
+    // share of the parent particle's velocity that is added to every new particle
+    float inherit_velocity;
+    // emitter the particles are spawned into, NULL is the owning emitter
+    ParticleEmitter* target;
+
+    SubEmitter(ParticleEvent::Type trigger, const Particle& particle, size_t count)
+    :trigger(trigger)
+    ,particle(particle)
+    ,count(count)
+    ,velocity_spread_x(0)
+    ,velocity_spread_y(0)
+    ,inherit_velocity(0)
+    ,target(NULL)
+    {}
+};
+
+typedef std::vector<SubEmitter> SubEmitterArray;
+typedef SubEmitterArray::const_iterator SubEmitterIterator;
+
 class ParticleEmitter
 {
-    Gosu::Graphics& graphics;
-    const Gosu::Image image;
+    Gosu::Graphics* graphics; // NULL for emitters that are only drawn in software.
+    const Gosu::Image* image; // NULL for emitters that are only drawn in software.
+    SoftwareTexture software_texture; // CPU copy of the image, created on first use.
     Gosu::ZPos z;
     size_t width; // Width of image.
     size_t height; // Height of image.
@@ -51,29 +97,150 @@ class ParticleEmitter
     unsigned int vbo_id;
 
     size_t count; // Current number of active particles.
+    size_t drawn_count; // Number of particles in the VBO, can lag behind count until the next update.
+
+    // What changed during the last update, so update_vbo only writes and uploads what's needed.
+    bool layout_changed; // Particles were created or killed.
+    bool particles_moving; // The drawn position, angle or size of any particle changed.
+    bool moved_last_step; // Any particle moved, rotated or was resized during the last step.
+    bool colors_fading; // Any particle changed its colour.
+    bool colors_uniform; // All particles have uniform_color, drawn without colour array.
+    bool color_array_valid; // False if the colour array was skipped while colours were uniform.
+    Gosu::Color uniform_color;
+    size_t upload_bytes_saved; // Colour and vertex bytes not written and uploaded during the last update.
     size_t max_particles; // No more will be created if max hit.
     ParticleIterator next_particle; // Next place to create a new particle (either dead or oldest living).
 
+    // Continuous emission, done in one batch at the start of every update.
+    Particle emission_template; // Position is relative to the emitter position.
+    EmitterShape shape; // Area around the emitter position new particles are spawned in.
+    float position_x, position_y;
+    float emission_rate; // New particles per tick.
+    float emission_accumulator; // Fraction of a particle left over from previous updates.
+    float velocity_spread_x, velocity_spread_y; // Random velocity added to each new particle.
+    uint32_t random_state;
+
+    // Fixed rate simulation, independent of how often update is called.
+    double simulation_step; // Seconds per step.
+    double time_accumulator; // Seconds not simulated yet.
+    double tick_accumulator; // Fraction of a tick not yet subtracted from time_to_live.
+    float interpolation; // Position of the drawn state between previous (0) and current (1) state.
+
+    // Deaths and collisions of the last update, consumed in one go by the sub emitters.
+    EventArray events;
+    SubEmitterArray sub_emitters;
+    bool collision_enabled;
+    float floor_y; // Particles moving below this bounce off it.
+    float bounce; // Share of the vertical velocity kept when bouncing.
+
     // do not copy
     ParticleEmitter(const ParticleEmitter&);
     ParticleEmitter& operator=(const ParticleEmitter&);
+    void init(size_t image_width, size_t image_height, const Gosu::GLTexInfo& tex_info);
     void init_vbo();
     void draw_vbo();
     void update_vbo();
     bool texture_changes() const;
+    bool colors_change() const;
+    bool vertices_change() const;
     static bool initialized_fast_math;
+    static uint32_t emitters_created; // Gives every emitter its own random sequence.
     void write_texture_coords_for_all_particles();
     void write_texture_coords_for_particles(VertexIterator& texture_coord,
                                                ParticleIterator first, ParticleIterator end);
     void write_vertices_for_particles(VertexIterator& vertex,
                                          ParticleIterator first, ParticleIterator end);
+    Particle& allocate_particle();
+    void emit_batch(const Particle& particle_template, const EmitterShape& spawn_shape,
+                    float x, float y, float velocity_x, float velocity_y,
+                    float spread_x, float spread_y, size_t n);
+    void process_events(size_t first_event);
+    void simulate();
+    void find_uniform_color();
+    // xorshift, cheaper than Gosu::random when spawning thousands of particles
+    float random_float()
+    {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return (random_state >> 8) * (1.0f / 16777216.0f);
+    }
 public:
     size_t getCount() const { return count; }
     ParticleEmitter(Gosu::Graphics& graphics, std::wstring filename, Gosu::ZPos z, size_t max_particles);
+    // Doesn't need OpenGL, can only be drawn with drawTo.
+    ParticleEmitter(const Gosu::Bitmap& texture, size_t max_particles);
     ~ParticleEmitter();
     void emit(Particle p);
+    void setPosition(float x, float y) { position_x = x; position_y = y; }
+    void setShape(const EmitterShape& s) { shape = s; }
+    void setEmissionTemplate(const Particle& p) { emission_template = p; }
+    // Negative rates emit nothing.
+    void setEmissionRate(float particles_per_tick) { emission_rate = particles_per_tick > 0 ? particles_per_tick : 0; }
+    void setVelocitySpread(float x, float y) { velocity_spread_x = x; velocity_spread_y = y; }
+    // Default is PARTICLE_TICKS_PER_SECOND, lower rates are cheaper and are interpolated when drawn.
+    // Higher rates run several steps per update; only stalls longer than MAX_SIMULATION_LAG are dropped.
+    void setSimulationRate(double steps_per_second);
+    void addSubEmitter(const SubEmitter& sub_emitter) { sub_emitters.push_back(sub_emitter); }
+    void setCollisionFloor(float y, float bounciness) { collision_enabled = true; floor_y = y; bounce = bounciness; }
+    void disableCollision() { collision_enabled = false; }
+    // Deaths and collisions that happened during the last update, in all of its steps.
+    const EventArray& getEvents() const { return events; }
+
+    // Bulk operations on living particles, visible after the next update.
+    // None of them cause death events.
+    void kill_in_rect(float left, float top, float right, float bottom);
+    // pred(const Particle&) returns true for particles to be killed.
+    template<typename Predicate> void kill_if(Predicate pred);
+    // fn(Particle&) may modify the particle, setting time_to_live to 0 kills it.
+    template<typename Function> void apply(Function fn);
+
+    // Bytes of vertex data that didn't need to be uploaded during the last update.
+    size_t getUploadBytesSaved() const { return upload_bytes_saved; }
+    void clear();
+    // Advances by one tick.
     void update();
+    void update(double seconds);
     void draw();
+    // Rasterizes the particles of the last update on the CPU.
+    void drawTo(SoftwareRenderer& renderer);
 };
 
+template<typename Predicate>
+void ParticleEmitter::kill_if(Predicate pred)
+{
+    if(count == 0) return;
+
+    for(ParticleIterator it = particles.begin(); it != particles.end(); it++)
+    {
+        const Particle& particle = *it;
+        if(particle.time_to_live > 0 && pred(particle))
+        {
+            it->time_to_live = 0;
+            count--;
+            layout_changed = true;
+        }
+    }
+    if(count == 0) next_particle = particles.begin();
+}
+
+template<typename Function>
+void ParticleEmitter::apply(Function fn)
+{
+    if(count == 0) return;
+
+    for(ParticleIterator it = particles.begin(); it != particles.end(); it++)
+    {
+        Particle& particle = *it;
+        if(particle.time_to_live > 0)
+        {
+            fn(particle);
+            if(particle.time_to_live == 0) count--;
+        }
+    }
+    // Anything might have changed.
+    layout_changed = true;
+    if(count == 0) next_particle = particles.begin();
+}
+
 #endif // PARTICLE_EMITTER_HPP
@@ -0,0 +1,290 @@
+#include "SoftwareRenderer.hpp"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SOFTWARE_RENDERER_SSE2
+#include <emmintrin.h>
+#endif
+
+// Exact x / 255 for 0 <= x <= 255 * 255.
+static inline uint32_t div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+#ifndef SOFTWARE_RENDERER_SSE2
+// Modulates texel by color and blends the result over dst like
+// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) does.
+// The alpha channel is composited "over", so the frame buffer stays usable as an image.
+static inline uint32_t blend_pixel(uint32_t dst, uint32_t texel, const uint16_t* color)
+{
+    uint32_t alpha = div255((texel >> 24) * color[3]);
+    uint32_t inverse = 255 - alpha;
+    uint32_t result = div255(255 * alpha + (dst >> 24) * inverse) << 24;
+    for(int shift = 0; shift < 24; shift += 8)
+    {
+        uint32_t src = div255(((texel >> shift) & 255) * color[shift / 8]);
+        result |= div255(src * alpha + ((dst >> shift) & 255) * inverse) << shift;
+    }
+    return result;
+}
+#endif
+
+SoftwareTexture::SoftwareTexture(const Gosu::Bitmap& bitmap)
+:width(bitmap.width())
+,height(bitmap.height())
+,texels(width * height)
+{
+    for(unsigned y = 0; y < height; y++)
+    {
+        for(unsigned x = 0; x < width; x++)
+        {
+            texels[y * width + x] = bitmap.getPixel(x, y).argb();
+        }
+    }
+}
+
+SoftwareRenderer::SoftwareRenderer(unsigned width, unsigned height)
+:width(width)
+,height(height)
+,stride((width + 3) & ~3u)
+,pixels(stride * height)
+,tiles_x((width + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE)
+,tiles_y((height + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE)
+,bins(tiles_x * tiles_y)
+{
+}
+
+void SoftwareRenderer::clear(Gosu::Color color)
+{
+    std::fill(pixels.begin(), pixels.end(), uint32_t(color.argb()));
+}
+
+void SoftwareRenderer::drawQuads(const Vertex2d* vertices, const Gosu::Color* colors, const Vertex2d* texture_coords,
+                                 size_t count, const SoftwareTexture& texture, const Gosu::GLTexInfo& tex_info,
+                                 Gosu::Color uniform_color)
+{
+    if(texture.empty()) return;
+
+    quads.clear();
+    for(size_t i = 0; i < bins.size(); i++)
+    {
+        bins[i].clear();
+    }
+
+    // Texture coordinates to texels.
+    float texels_x = texture.width / (tex_info.right - tex_info.left);
+    float texels_y = texture.height / (tex_info.bottom - tex_info.top);
+
+    // Set up every quad once and sort it into all the tiles it touches.
+    for(size_t i = 0; i < count; i++)
+    {
+        const Vertex2d* vertex = vertices + i * 4;
+        const Vertex2d* tex = texture_coords + i * 4;
+        Gosu::Color color = colors ? colors[i * 4] : uniform_color;
+        if(color.alpha() == 0) continue;
+
+        float min_x = vertex[0].x, max_x = vertex[0].x;
+        float min_y = vertex[0].y, max_y = vertex[0].y;
+        for(int j = 1; j < 4; j++)
+        {
+            min_x = std::min(min_x, vertex[j].x);
+            max_x = std::max(max_x, vertex[j].x);
+            min_y = std::min(min_y, vertex[j].y);
+            max_y = std::max(max_y, vertex[j].y);
+        }
+
+        QuadSetup quad;
+        quad.left = std::max(0, int(std::floor(min_x)));
+        quad.top = std::max(0, int(std::floor(min_y)));
+        quad.right = std::min(int(width), int(std::ceil(max_x)));
+        quad.bottom = std::min(int(height), int(std::ceil(max_y)));
+        if(quad.left >= quad.right || quad.top >= quad.bottom) continue;
+
+        // Particle quads are parallelograms, so a point is vertex[0] + s * (vertex[1] - vertex[0]) + t * (vertex[3] - vertex[0]).
+        float edge_s_x = vertex[1].x - vertex[0].x;
+        float edge_s_y = vertex[1].y - vertex[0].y;
+        float edge_t_x = vertex[3].x - vertex[0].x;
+        float edge_t_y = vertex[3].y - vertex[0].y;
+        float det = edge_s_x * edge_t_y - edge_s_y * edge_t_x;
+        if(std::fabs(det) < 1e-6f) continue;
+
+        quad.s[1] = edge_t_y / det;
+        quad.s[2] = -edge_t_x / det;
+        quad.s[0] = -(vertex[0].x * quad.s[1] + vertex[0].y * quad.s[2]);
+        quad.t[1] = -edge_s_y / det;
+        quad.t[2] = edge_s_x / det;
+        quad.t[0] = -(vertex[0].x * quad.t[1] + vertex[0].y * quad.t[2]);
+
+        float u0 = (tex[0].x - tex_info.left) * texels_x;
+        float u_s = (tex[1].x - tex[0].x) * texels_x;
+        float u_t = (tex[3].x - tex[0].x) * texels_x;
+        float v0 = (tex[0].y - tex_info.top) * texels_y;
+        float v_s = (tex[1].y - tex[0].y) * texels_y;
+        float v_t = (tex[3].y - tex[0].y) * texels_y;
+        for(int k = 0; k < 3; k++)
+        {
+            quad.u[k] = u_s * quad.s[k] + u_t * quad.t[k];
+            quad.v[k] = v_s * quad.s[k] + v_t * quad.t[k];
+        }
+        quad.u[0] += u0;
+        quad.v[0] += v0;
+
+        quad.color[0] = color.blue();
+        quad.color[1] = color.green();
+        quad.color[2] = color.red();
+        quad.color[3] = color.alpha();
+
+        uint32_t index = quads.size();
+        quads.push_back(quad);
+
+        for(int tile_y = quad.top / SOFTWARE_TILE_SIZE; tile_y <= (quad.bottom - 1) / SOFTWARE_TILE_SIZE; tile_y++)
+        {
+            for(int tile_x = quad.left / SOFTWARE_TILE_SIZE; tile_x <= (quad.right - 1) / SOFTWARE_TILE_SIZE; tile_x++)
+            {
+                bins[tile_y * tiles_x + tile_x].push_back(index);
+            }
+        }
+    }
+
+    // Tiles don't share any pixels, so they can be rendered in parallel.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int tile = 0; tile < int(bins.size()); tile++)
+    {
+        if(!bins[tile].empty()) render_tile(tile, texture);
+    }
+}
+
+void SoftwareRenderer::render_tile(size_t tile, const SoftwareTexture& texture)
+{
+    int tile_left = (tile % tiles_x) * SOFTWARE_TILE_SIZE;
+    int tile_top = (tile / tiles_x) * SOFTWARE_TILE_SIZE;
+    int tile_right = std::min(int(width), tile_left + SOFTWARE_TILE_SIZE);
+    int tile_bottom = std::min(int(height), tile_top + SOFTWARE_TILE_SIZE);
+    float max_u = texture.width - 1;
+    float max_v = texture.height - 1;
+    const std::vector<uint32_t>& bin = bins[tile];
+
+    for(size_t i = 0; i < bin.size(); i++)
+    {
+        const QuadSetup& quad = quads[bin[i]];
+        int left = std::max(quad.left, tile_left);
+        int right = std::min(quad.right, tile_right);
+        int top = std::max(quad.top, tile_top);
+        int bottom = std::min(quad.bottom, tile_bottom);
+
+        for(int y = top; y < bottom; y++)
+        {
+            uint32_t* row = &pixels[y * stride];
+            // Sample at pixel centers.
+            float center_y = y + 0.5f;
+            float s_row = quad.s[0] + quad.s[2] * center_y;
+            float t_row = quad.t[0] + quad.t[2] * center_y;
+            float u_row = quad.u[0] + quad.u[2] * center_y;
+            float v_row = quad.v[0] + quad.v[2] * center_y;
+
+#ifdef SOFTWARE_RENDERER_SSE2
+            // Four pixels at a time. Starting at a multiple of 4 never leaves the tile,
+            // and the row stride is padded so the last group never leaves the row.
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+            const __m128i color = _mm_set_epi16(quad.color[3], quad.color[2], quad.color[1], quad.color[0],
+                                                quad.color[3], quad.color[2], quad.color[1], quad.color[0]);
+            const __m128i alpha_channel = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+            const __m128i opaque = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+            const __m128i full = _mm_set1_epi16(255);
+            const __m128i half = _mm_set1_epi16(128);
+            const __m128i zero_i = _mm_setzero_si128();
+
+            for(int x = left & ~3; x < right; x += 4)
+            {
+                __m128i index = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+                __m128 center_x = _mm_add_ps(_mm_cvtepi32_ps(index), _mm_set1_ps(0.5f));
+                __m128 s = _mm_add_ps(_mm_set1_ps(s_row), _mm_mul_ps(_mm_set1_ps(quad.s[1]), center_x));
+                __m128 t = _mm_add_ps(_mm_set1_ps(t_row), _mm_mul_ps(_mm_set1_ps(quad.t[1]), center_x));
+
+                __m128i inside = _mm_and_si128(_mm_cmpgt_epi32(index, _mm_set1_epi32(left - 1)),
+                                               _mm_cmplt_epi32(index, _mm_set1_epi32(right)));
+                __m128 covered = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(s, zero), _mm_cmplt_ps(s, one)),
+                                            _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, one)));
+                __m128i mask = _mm_and_si128(inside, _mm_castps_si128(covered));
+                int bits = _mm_movemask_ps(_mm_castsi128_ps(mask));
+                if(bits == 0) continue;
+
+                __m128 u = _mm_add_ps(_mm_set1_ps(u_row), _mm_mul_ps(_mm_set1_ps(quad.u[1]), center_x));
+                __m128 v = _mm_add_ps(_mm_set1_ps(v_row), _mm_mul_ps(_mm_set1_ps(quad.v[1]), center_x));
+                u = _mm_min_ps(_mm_max_ps(u, zero), _mm_set1_ps(max_u));
+                v = _mm_min_ps(_mm_max_ps(v, zero), _mm_set1_ps(max_v));
+                int32_t texel_u[4], texel_v[4];
+                _mm_storeu_si128((__m128i*)texel_u, _mm_cvttps_epi32(u));
+                _mm_storeu_si128((__m128i*)texel_v, _mm_cvttps_epi32(v));
+
+                // No gather in SSE2.
+                uint32_t gathered[4];
+                for(int lane = 0; lane < 4; lane++)
+                {
+                    gathered[lane] = (bits & (1 << lane))
+                        ? texture.texels[texel_v[lane] * texture.width + texel_u[lane]] : 0;
+                }
+                __m128i src = _mm_loadu_si128((const __m128i*)gathered);
+                __m128i dst = _mm_loadu_si128((const __m128i*)(row + x));
+
+                // Two pixels per register, 16 bits per channel.
+                __m128i src_halves[2] = { _mm_unpacklo_epi8(src, zero_i), _mm_unpackhi_epi8(src, zero_i) };
+                __m128i dst_halves[2] = { _mm_unpacklo_epi8(dst, zero_i), _mm_unpackhi_epi8(dst, zero_i) };
+                for(int h = 0; h < 2; h++)
+                {
+                    // Modulate by the particle colour.
+                    __m128i c = _mm_mullo_epi16(src_halves[h], color);
+                    c = _mm_add_epi16(c, half);
+                    c = _mm_srli_epi16(_mm_add_epi16(c, _mm_srli_epi16(c, 8)), 8);
+
+                    // Spread each pixel's alpha over its channels.
+                    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)),
+                                                        _MM_SHUFFLE(3, 3, 3, 3));
+                    __m128i inverse = _mm_sub_epi16(full, alpha);
+                    c = _mm_or_si128(_mm_andnot_si128(alpha_channel, c), opaque);
+
+                    __m128i r = _mm_add_epi16(_mm_mullo_epi16(c, alpha), _mm_mullo_epi16(dst_halves[h], inverse));
+                    r = _mm_add_epi16(r, half);
+                    dst_halves[h] = _mm_srli_epi16(_mm_add_epi16(r, _mm_srli_epi16(r, 8)), 8);
+                }
+                __m128i result = _mm_packus_epi16(dst_halves[0], dst_halves[1]);
+                result = _mm_or_si128(_mm_and_si128(mask, result), _mm_andnot_si128(mask, dst));
+                _mm_storeu_si128((__m128i*)(row + x), result);
+            }
+#else
+            for(int x = left; x < right; x++)
+            {
+                float center_x = x + 0.5f;
+                float s = s_row + quad.s[1] * center_x;
+                float t = t_row + quad.t[1] * center_x;
+                if(s < 0 || s >= 1 || t < 0 || t >= 1) continue;
+
+                float u = std::min(std::max(u_row + quad.u[1] * center_x, 0.0f), max_u);
+                float v = std::min(std::max(v_row + quad.v[1] * center_x, 0.0f), max_v);
+                uint32_t texel = texture.texels[size_t(v) * texture.width + size_t(u)];
+                row[x] = blend_pixel(row[x], texel, quad.color);
+            }
+#endif
+        }
+    }
+}
+
+Gosu::Bitmap SoftwareRenderer::toBitmap() const
+{
+    Gosu::Bitmap bitmap(width, height);
+    for(unsigned y = 0; y < height; y++)
+    {
+        for(unsigned x = 0; x < width; x++)
+        {
+            bitmap.setPixel(x, y, Gosu::Color(pixels[y * stride + x]));
+        }
+    }
+    return bitmap;
+}
@@ -0,0 +1,67 @@
+#ifndef SOFTWARE_RENDERER_HPP
+#define SOFTWARE_RENDERER_HPP
+
+// CPU fallback for hosts without OpenGL, draws the same arrays the emitters upload into their VBO.
+
+#include <vector>
+#include <stdint.h>
+#include <Gosu/Fwd.hpp>
+#include <Gosu/Color.hpp>
+#include <Gosu/Bitmap.hpp>
+#include <Gosu/ImageData.hpp>
+#include "Vertex2d.hpp"
+
+// Width and height of the screen areas that are rasterized independently of each other.
+#define SOFTWARE_TILE_SIZE 64
+
+// Image converted to 0xAARRGGBB values for sampling.
+struct SoftwareTexture
+{
+    unsigned width, height;
+    std::vector<uint32_t> texels;
+
+    SoftwareTexture():width(0),height(0) {}
+    explicit SoftwareTexture(const Gosu::Bitmap& bitmap);
+    bool empty() const { return texels.empty(); }
+};
+
+class SoftwareRenderer
+{
+    // Screen space setup of one quad.
+    struct QuadSetup
+    {
+        int left, top, right, bottom; // Clipped bounding box, right/bottom exclusive.
+        float s[3], t[3]; // Position along the quad's edges, as s[0] + s[1] * x + s[2] * y.
+        float u[3], v[3]; // Texel coordinates, same layout.
+        uint16_t color[4]; // b, g, r, a
+    };
+
+    unsigned width, height;
+    size_t stride; // Pixels per row, padded so rows can be processed 4 pixels at a time.
+    std::vector<uint32_t> pixels; // 0xAARRGGBB
+    size_t tiles_x, tiles_y;
+
+    // Reused between frames to avoid allocations.
+    std::vector<QuadSetup> quads;
+    std::vector<std::vector<uint32_t> > bins; // Indices into quads, per tile, in drawing order.
+
+    void render_tile(size_t tile, const SoftwareTexture& texture);
+
+public:
+    SoftwareRenderer(unsigned width, unsigned height);
+
+    unsigned getWidth() const { return width; }
+    unsigned getHeight() const { return height; }
+
+    void clear(Gosu::Color color);
+    // Alpha blends textured quads, given as four vertices, colours and texture coords each,
+    // in the order ParticleEmitter writes them. tex_info is the area of texture coordinate
+    // space that the texture covers. If colors is NULL, all quads use uniform_color.
+    void drawQuads(const Vertex2d* vertices, const Gosu::Color* colors, const Vertex2d* texture_coords,
+                   size_t count, const SoftwareTexture& texture, const Gosu::GLTexInfo& tex_info,
+                   Gosu::Color uniform_color);
+    // Copy of the frame buffer, e.g. to save it with Gosu::saveImageFile.
+    Gosu::Bitmap toBitmap() const;
+};
+
+#endif // SOFTWARE_RENDERER_HPP
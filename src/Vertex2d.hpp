@@ -0,0 +1,9 @@
+#ifndef VERTEX2D_HPP
+#define VERTEX2D_HPP
+
+typedef struct _vertex2d
+{
+    float x, y;
+} Vertex2d;
+
+#endif // VERTEX2D_HPP